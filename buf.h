@@ -1,31 +1,65 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <deque>
 #include "db.h"
+#include "replacer.h"
+#include "zcache.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
 // declarations for buffer pool hash table
 struct hashBucket
 {
-	File*	file;    // pointer a file object (more on this below)
+	File*	file;    // pointer a file object (more on this below); NULL if slot is empty
 	int	pageNo;  // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
 };
 
 
 // hash table to keep track of pages in the buffer pool
+//
+// Open addressing with Robin Hood linear probing over one flat array of
+// buckets, so insert and remove never allocate and a lookup touches one
+// or two cache lines.  The table only reallocates (doubling) if it ever
+// gets more than 7/8 full, which a table sized for the pool never does.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    unsigned int  mask;    // number of buckets - 1, buckets is a power of two
+    int	 count;            // number of entries in use
+    hashBucket*  ht; // actual hash table
+    unsigned int hash(const File* file, const int pageNo) const { // returns value between 0 and mask
+	return (unsigned int)mix(file, pageNo) & mask;
+    }
+    unsigned int dist(const unsigned int index) const { // probe distance of entry at index
+	return (index - hash(ht[index].file, ht[index].pageNo)) & mask;
+    }
+    void grow();           // double the number of buckets and rehash
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    BufHashTbl(const int htSize);  // constructor, room for htSize entries
     ~BufHashTbl(); // destructor
+
+    // 64-bit mix of (file, pageNo).  The table uses the low bits; callers
+    // that partition the key space should use the high ones.
+    static unsigned long long mix(const File* file, const int pageNo)
+    {
+	unsigned long long h = (unsigned long long)(unsigned long)file
+			     ^ ((unsigned long long)(unsigned int)pageNo << 32);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+    }
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
     // returns 0 if OK, HASHTBLERROR if an error occurred
@@ -42,19 +76,69 @@ public:
 };
 
 
+// The hash table itself is not thread safe.  BufMgr splits the
+// (File, page) space into HTPARTS partitions, each with its own
+// BufHashTbl and latch, so lookups of unrelated pages never contend.
+const int HTPARTS = 16;
+
+struct HashPart
+{
+  std::mutex	latch;	// protects table
+  BufHashTbl*	table;	// mappings of pages hashed to this partition
+};
+
+
+// number of frames the background writer examines per batch
+const int WRITEBATCH = 64;
+
+// read-ahead: number of files whose access pattern is tracked at once,
+// sequential reads in a row before pages are read ahead, and the
+// smallest read-ahead window in pages
+const int RASTREAMS = 16;
+const int RATRIGGER = 2;
+const int RAMINWINDOW = 4;
+
+
+// How a BufMgr maps its frames, or-ed together.  The frames and their
+// descriptors always live in one region aligned to HUGEPAGESIZE that
+// the kernel fills in on first touch and is asked to back with
+// transparent huge pages.
+enum PoolOptions {
+  POOL_DEFAULT = 0,
+  POOL_HUGETLB = 1,	// use explicit huge pages (MAP_HUGETLB) if enough
+			// are reserved, else fall back to the default
+  POOL_INTERLEAVE = 2	// spread the frames over all online NUMA nodes
+};
+
+const unsigned long HUGEPAGESIZE = 2 * 1024 * 1024;
+
+
 class BufMgr;  //forward declaration of BufMgr class 
+class LogMgr;
 
 // class for maintaining information about buffer pool frames
+//
+// pinCnt, dirty and valid may be read and updated by any thread
+// without a latch.  file and pageNo only change while latch is held,
+// and latch stays held for the whole time a page is being read into the
+// frame (ioPending is set) or the frame is being evicted.  content is
+// taken by PageGuards, never by the buffer manager itself.
 class BufDesc {
     friend class BufMgr;
+    friend class PageGuard;
 private:
   File* file;   // pointer to file object
   int   pageNo; // page within file
   int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
-  bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  std::atomic<int>  pinCnt; // number of times this page has been pinned
+  std::atomic<bool> dirty;	  // true if dirty;  false otherwise
+  std::atomic<bool> valid;   // true if page is valid
+  std::atomic<bool> ioPending; // true while the page is read from disk
+  std::atomic<bool> prefetched; // read ahead and not asked for since
+  std::atomic<LSN> pageLSN; // last change logged, 0 if none since read;
+			    // set by allocPage too, see stampFrame
+  std::mutex latch;	 // serializes loading, writing and evicting the frame
+  std::shared_mutex content; // latch on the page contents, see PageGuard
 
   void Clear() {  // initialize buffer frame for a new user
     	pinCnt = 0;
@@ -62,6 +146,9 @@ private:
 	pageNo = -1;
     	dirty = false;
 	valid = false;
+	ioPending = false;
+	prefetched = false;
+	pageLSN = 0;
   };
 
   void Set(File* filePtr, int pageNum) { 
@@ -70,7 +157,8 @@ private:
       pinCnt = 1;
       dirty = false;
       valid = true;
-      refbit = true;
+      prefetched = false;
+      pageLSN = 0;
   }
 
   BufDesc() {
@@ -79,55 +167,303 @@ private:
 };
 
 
+// How a PageGuard latches the page it pins.  Any number of shared
+// guards may hold a page at once; an exclusive guard holds it alone.
+// Pages pinned through the Page*& calls are not latched at all.
+enum LatchMode {
+  LATCH_SHARED,
+  LATCH_EXCLUSIVE
+};
+
+// A pin on one page, taken by the PageGuard versions of
+// BufMgr::readPage and allocPage.  The guard drops the pin when it is
+// destroyed if release() was not called before, so a pin cannot leak,
+// and it latches the page.  It remembers the frame, so dropping the pin
+// goes without the hash table lookup unPinPage makes; that is no
+// faster overall, as the page latch costs about as much (benchguard).
+// Guards can be moved but not copied.
+class PageGuard {
+    friend class BufMgr;
+public:
+  PageGuard() { clear(); }
+  ~PageGuard() { release(); }
+  PageGuard(PageGuard&& other) { clear(); *this = std::move(other); }
+  PageGuard& operator=(PageGuard&& other);
+  PageGuard(const PageGuard&) = delete;
+  PageGuard& operator=(const PageGuard&) = delete;
+
+  Page* get() const { return page; }
+  Page* operator->() const { return page; }
+  bool holds() const { return bufMgr != NULL; } // a page is pinned
+  int getPageNo() const { return pageNo; }
+  int getFrameNo() const { return frameNo; }
+  LatchMode getMode() const { return mode; }
+
+  // The page was changed; it is unpinned dirty when released.
+  void markDirty() { dirty = true; }
+
+  // Unlatch and unpin the page now.  Does nothing if none is held.
+  void release();
+
+private:
+  BufMgr*	bufMgr;		// NULL if no page is pinned
+  int		pageNo;
+  int		frameNo;
+  Page*		page;
+  LatchMode	mode;
+  bool		dirty;
+
+  void clear()
+  {
+	bufMgr = NULL;
+	pageNo = frameNo = -1;
+	page = NULL;
+	mode = LATCH_SHARED;
+	dirty = false;
+  }
+};
+
+
+// Counters of a BufMgr.  They are 64 bits wide and spread over cache
+// lines (see Counter in stats.h), so they cost little to keep on.
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  Counter accesses;    // Total number of accesses to buffer pool
+  Counter hits;        // Accesses that found the page in the pool
+  Counter misses;      // Accesses that had to read the page
+  Counter lookups;     // Hash table lookups
+  Counter diskreads;   // Number of pages read from disk (including allocs)
+  Counter diskwrites;  // Number of pages written back to disk
+  Counter evictions;   // Number of pages evicted to make room
+  Counter fgwrites;    // Evictions that had to write the page first
+  Counter bgwrites;    // Pages written by the background writer
+  Counter flushes;     // flushFile calls
+  Counter allocs;      // Pages allocated
+  Counter prefetches;  // Pages read ahead (also counted in diskreads)
+  Counter prefetchHits;   // Pages read ahead that were then asked for
+  Counter prefetchWasted; // Pages read ahead and evicted unused
+  Histogram sweep;     // frames allocBuf looked at to find one
 
   void clear()
     {
-      accesses = diskreads = diskwrites = 0;
-    }
-      
-  BufStats()
-    {
-      clear();
+      accesses.clear(); hits.clear(); misses.clear(); lookups.clear();
+      diskreads.clear(); diskwrites.clear();
+      evictions.clear(); fgwrites.clear(); bgwrites.clear();
+      flushes.clear(); allocs.clear();
+      prefetches.clear(); prefetchHits.clear(); prefetchWasted.clear();
+      sweep.clear();
     }
 };
 
+// The values of a BufMgr's counters at one point in time, with the
+// pool state they go with.
+struct PoolSnapshot
+{
+  int numBufs;			// frames in the pool
+  int dirtyPages;		// frames dirty when taken
+  unsigned long long accesses, hits, misses, lookups;
+  unsigned long long diskreads, diskwrites;
+  unsigned long long evictions, fgwrites, bgwrites, flushes, allocs;
+  unsigned long long prefetches, prefetchHits, prefetchWasted;
+  HistSnapshot sweep;
+  ZSnapshot tier;		// the compressed tier, budget 0 if none
+
+  double hitRatio() const { return accesses ? (double)hits / accesses : 0; }
+  double evictionRate() const	// evictions per access
+    { return accesses ? (double)evictions / accesses : 0; }
+
+  void printText(std::ostream& os) const;
+  void printJSON(std::ostream& os) const;
+};
 
+
+// All public BufMgr methods may be called concurrently from any number
+// of threads, except the constructor, destructor and printSelf.
 class BufMgr 
 {
+    friend class PageGuard;
 private:
-  unsigned int 	 clockHand;
   int   	 numBufs;    	// Number of pages in buffer pool
-  BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
+  HashPart*      hashParts;  	// partitioned hash table mapping (File, page) to frame
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
   BufStats	 bufStats;	// buffer pool statistics
+  Replacer*	 replacer;	// picks the frames allocBuf evicts
+  std::atomic<int> dirtyPages;	// number of frames with the dirty bit set
+  void*		 region;	// mapping holding bufPool and bufTable
+  unsigned long	 regionSize;
+  bool		 hugetlb;	// region is backed by explicit huge pages
+  double	 constructTime;	// seconds the constructor took
+  LogMgr*	 log;		// write-ahead log, NULL if none
+  unsigned	 frameSize;	// bytes per frame, the largest page size
+  ZCache*	 ztier;		// compressed second tier, NULL if none
+
+  // background writer, see startWriter()
+  std::thread	 writer;
+  std::mutex	 writerLatch;	// protects writerStop
+  std::condition_variable writerWake;
+  bool		 writerStop;
+  std::atomic<int> dirtyHighWater; // in frames, 0 if no writer is running
+  int		 cleanAhead;	// frames ahead of eviction to keep clean
+
+  // read-ahead, see startReadAhead().  A stream tracks one sequential
+  // reader of a file; pages up to lastPage + window are queued for the
+  // workers.
+  struct RAStream
+  {
+    const File*	file;		// NULL if the slot is unused
+    int		lastPage;	// page read last
+    int		run;		// sequential reads in a row
+    int		window;		// pages to keep read ahead of lastPage
+    int		next;		// next page to queue
+    int		limit;		// reads from here on failed (end of file)
+  };
+  struct RARequest
+  {
+    File*	file;
+    int		pageNo;
+  };
+  std::vector<std::thread> raWorkers;
+  std::mutex	 raLatch;	// protects everything below
+  std::condition_variable raWake;	// work was queued
+  std::condition_variable raIdle;	// a worker finished a page
+  std::deque<RARequest> raQueue;
+  const File**	 raBusy;	// file each worker is reading, NULL if idle
+  RAStream	 raStreams[RASTREAMS];
+  int		 raClock;	// stream slot to reuse next
+  bool		 raStop;
+  std::atomic<int> raMaxWindow;	// largest window, 0 if read-ahead is off
 
   const Status allocBuf(int & frame);   // allocate a free frame.  
   const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
+  void writerLoop();			// body of the background writer
+
+  // body of readPage; also used by the read-ahead workers
+  const Status fetchPage(File* file, const int PageNo, int& frameNo,
+                         const bool prefetch, bool& prefetchHit);
+  void readAheadLoop(const int worker);	// body of a read-ahead worker
+  RAStream* findStream(const File* file, const int pageNo);
+  void noteAccess(File* file, const int pageNo, const bool prefetchHit);
+  void noteWasted(const File* file);	// a page of file was read ahead in vain
+  void cancelReadAhead(const File* file); // forget file, wait for its reads
+  int  cleanFrames(const int* frames, const int n); // write those that are dirty and unpinned
+  const Status writeBatch(const int* frames, const int n,
+                          const bool sync, int& written); // write latched frames
+  void unPinFrame(const int frameNo, const bool dirty); // caller holds a pin
+  const Status logBefore(const LSN lsn); // flush the log up to lsn
+  LSN  allocLSN();			// LSN to stamp a new page with
+  void stampFrame(const int frameNo);	// before the frame is written
+  void guardFrame(PageGuard& guard, const int frameNo,
+                  const LatchMode mode);	// latch a pinned frame for guard
+
+  // set or clear the dirty bit of desc, keeping dirtyPages up to date;
+  // markClean returns true if the bit was set
+  void markDirty(BufDesc* desc)
+  {
+	if (!desc->dirty.exchange(true))
+	    dirtyPages++;
+  }
+  bool markClean(BufDesc* desc)
   {
-	clockHand = (clockHand + 1) % numBufs;
+	if (!desc->dirty.exchange(false))
+	    return false;
+	dirtyPages--;
+	return true;
+  }
+
+  // page held in frame i; frames are frameSize bytes apart
+  Page* framePage(const int i) const
+  {
+	return (Page*)((char*)bufPool + (unsigned long)i * frameSize);
+  }
+
+  // partition of the hash table that (file, pageNo) belongs to
+  HashPart& partition(const File* file, const int pageNo)
+  {
+	return hashParts[(BufHashTbl::mix(file, pageNo) >> 48) % HTPARTS];
+  }
+
+  // wait until a read into a frame we just pinned has finished;
+  // returns false if that read failed and the frame is unusable
+  bool waitForIO(BufDesc* desc)
+  {
+	if (desc->ioPending) {
+	    desc->latch.lock();
+	    desc->latch.unlock();
+	}
+	return desc->valid;
   }
 
 
 public:
-  Page*	         bufPool;   // actual buffer pool
+  Page*	         bufPool;   // actual buffer pool, frameSize bytes per frame
 
-  BufMgr(const int bufs);
+  // A pool of bufs frames of frameSize bytes each.  It holds pages of
+  // files whose page size is at most frameSize.
+  BufMgr(const int bufs, const ReplPolicy policy = CLOCK,
+         const int poolOptions = POOL_DEFAULT,
+         const unsigned frameSize = PAGESIZE);
   ~BufMgr();
 
   const Status readPage(File* file, const int PageNo, Page*& page);
   const Status unPinPage(File* file, const int PageNo, const bool dirty);
   const Status allocPage(File* file, int& PageNo, Page*& page); 
                         // allocates a new, empty page 
-  const Status flushFile(const File* file); // writing out all dirty pages of the file
-  const Status disposePage(File* file, const int PageNo); // dispose of page in file
+  const Status flushFile(const File* file,
+                         const bool sync = false); // writing out all dirty pages of the file
+  const Status disposePage(File* file, const int PageNo); // dispose of an unpinned page
+
+  // The same as readPage and allocPage, but the pin is held by guard,
+  // which also latches the page: in mode for readPage, exclusively for
+  // allocPage.  A page guard already held is released first.
+  const Status readPage(File* file, const int PageNo, PageGuard& guard,
+                        const LatchMode mode = LATCH_SHARED);
+  const Status allocPage(File* file, int& PageNo, PageGuard& guard);
+
+  // Use log as write-ahead log (see log.h), or none if NULL.  With a
+  // log, a dirty page is only written once the log is on disk up to
+  // the page's LSN.  Pages handed out by allocPage and pages disposed
+  // of go to disk stamped with the end of the log at that time, so
+  // that recovery does not replay records of their earlier use over
+  // them.  These stamps, too, go to bytes PAGELSNAT on of every page.
+  // Set it while the pool holds no dirty page.
+  void setLog(LogMgr* log) { this->log = log; }
+
+  // Log bytes bytes at offset of a page the caller has pinned and
+  // changed, stamp the page with the record's LSN and mark it dirty.
+  // The LSN goes to bytes PAGELSNAT on, slotted page or not (page.h).
+  // The change is durable once LogMgr::flush(lsn) returns.  Returns
+  // BADLOG if there is no log.  Concurrent changes of the page must be
+  // kept apart by the caller, e.g. with an exclusive PageGuard.
+  const Status logPage(File* file, const int PageNo, const unsigned offset,
+                       const unsigned bytes, LSN& lsn);
   void  printSelf();
 
+  // Start a thread that writes dirty, unpinned pages before they are
+  // evicted, so that misses rarely have to write a victim themselves.
+  // It keeps the next aheadPct percent of the frames the replacement
+  // policy would evict clean, and whenever more than highWaterPct
+  // percent of the pool is dirty it writes pages until half that is
+  // left.  The writer is stopped by stopWriter() or the destructor.
+  void  startWriter(const int highWaterPct = 20, const int aheadPct = 10);
+  void  stopWriter();
+
+  // Start threads that read pages ahead of sequential readers.  After
+  // RATRIGGER consecutive readPage calls on a file, the next pages are
+  // read into unpinned frames, inserted where the replacement policy
+  // evicts first.  The window starts at RAMINWINDOW pages, doubles (up
+  // to maxWindow, and at most a quarter of the pool) each time a page
+  // read ahead is asked for and is halved each time one is evicted
+  // unused.  Stopped by stopReadAhead() or the destructor.
+  void  startReadAhead(const int maxWindow = 64, const int threads = 2);
+  void  stopReadAhead();
+
+  // Keep evicted pages compressed in budget bytes of memory (see
+  // zcache.h), or not at all if budget is 0, dropping what the tier
+  // held before.  A miss in the pool then looks in the tier before it
+  // reads the page from disk; those misses are not counted as disk
+  // reads.  Only while no other thread uses the pool.
+  void  setCompressedTier(const unsigned long long budget);
+
   const BufStats & getBufStats() const // get buffer pool usage
   {
 	return bufStats;
@@ -135,7 +471,18 @@ public:
   const void clearBufStats() 
   {
 	bufStats.clear();
+	if (ztier)
+	    ztier->clearStats();
   }
+
+  // copy the counters; cheap enough to call while the pool is busy
+  void snapshot(PoolSnapshot& snap) const;
+
+  // seconds it took to construct the pool, and whether it got explicit
+  // huge pages
+  double getConstructTime() const { return constructTime; }
+  bool usesHugeTLB() const { return hugetlb; }
+  unsigned getFrameSize() const { return frameSize; }
 };
 
 #endif
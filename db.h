@@ -3,7 +3,11 @@
 
 #include <sys/types.h>
 #include <functional>
+#include <mutex>
+#include <vector>
 #include "error.h"
+#include "page.h"
+#include "stats.h"
 #include <string.h>
 using namespace std;
 
@@ -14,21 +18,77 @@ using namespace std;
 
 // forward class definition for db
 class DB;
+struct iovec;
+
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int extentNext;                       // first page of the reserved extent
+  int extentEnd;                        // page after the reserved extent
+  int pageSize;                         // bytes per page, 0 means PAGESIZE
+  int fsmFirst;                         // first free space map page, 0 if none
+} DBPage;
+
+// The free space map keeps a category from 0 to FSMCATS-1 for every
+// page of a file, two pages to a byte: category c means at least
+// c * pageSize / FSMCATS bytes are free.  It is stored in map pages
+// chained from DBPage.fsmFirst; each holds the next map page's number
+// (0 at the end) followed by the categories of the pages it covers.
+const int FSMCATS = 16;
+
+// one page of a batch handed to File::writePages
+struct PageWrite
+{
+  int		pageNo;		// page within file
+  const Page*	page;		// contents to write
+};
 
 // class definition for open files
 class File {
   friend class DB;
   friend class OpenFileHashTbl;
+  friend class BufMgr;                  // counts pool events in stats
+  friend class LogMgr;                  // names files in log records,
+                                        // grows them in recovery
 
  public:
 
   Status allocatePage(int& pageNo);     // allocate a new page
-  const Status disposePage(const int pageNo);       // release space for a page
+  const Status allocateExtent(const int count,
+		  int& firstPageNo);          // allocate count adjacent pages
+  const Status reserveExtent(const int count); // grow file by count pages
+					      // for allocatePage to hand out
+  const Status disposePage(const int pageNo,
+		  const LSN lsn = 0);         // release space for a page,
+					      // stamp it with lsn
   const Status readPage(const int pageNo,
 		  Page* pagePtr) const;       // read page from file
   const Status writePage(const int pageNo,
 		   const Page* pagePtr);      // write page to file
+  const Status writePages(PageWrite* writes, const int n,
+		   const bool sync = false);  // write a batch of pages,
+					      // sorts writes by pageNo
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  int getNumPages() const;              // pages in the file, header included
+  unsigned getPageSize() const { return pageSize; } // bytes per page
+  const Status sync();                  // write header, force file to disk
+  const Status syncHeader();            // the same for a changed header only
+  const Status setDirect(const bool on); // bypass the OS page cache
+
+  // record that page pageNo of a slotted Page has bytes free; done by
+  // writePage and writePages for every slotted Page they write
+  void noteFreeSpace(const int pageNo, const int bytes);
+  // a page that had at least bytes free when it was last recorded, or
+  // NOSPACE if there is none; no data page is read
+  const Status findFreePage(const int bytes, int& pageNo);
+
+  // copy out the counters and I/O latencies of the file; clearStats
+  // sets them back to zero
+  void snapshot(FileSnapshot& snap) const;
+  void clearStats() { stats.clear(); }
 
   bool operator == (const File & other) const
     {
@@ -40,16 +100,29 @@ class File {
   File(const string &fname);                   // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName,
+			     const unsigned pageSize);
   static const Status destroy(const string &fileName);
 
   const Status open();
   const Status close();
 
-  const Status intread(const int pageNo,
-		 Page* pagePtr) const;        // internal file read
-  const Status intwrite(const int pageNo,
-		  const Page* pagePtr);       // internal file write
+  const Status intread(const int pageNo, Page* pagePtr,
+		 const unsigned bytes) const; // internal file read
+  const Status intwrite(const int pageNo, const Page* pagePtr,
+		  const unsigned bytes);      // internal file write
+  const Status intwritev(const int pageNo, struct iovec* iov,
+		  const int cnt);             // write cnt adjacent pages
+  const Status grow(const int count);   // add count zeroed pages at the end
+  const Status pushFree(const int pageNo,
+		  const LSN lsn = 0);         // link pageNo into the free list
+  const Status writeHeader();           // write hdr back if it changed
+  const Status forceHeader(const bool always); // and fdatasync
+  const Status readMap();               // load the free space map
+  const Status writeMap();              // write changed map pages back
+  void setCategory(const int pageNo, const int cat); // fsmLatch held
+  void noteWritten(const PageWrite* writes, const int n); // for the map
+  int mapCoverage() const { return (pageSize - sizeof(int)) * 2; }
 
 #ifdef DEBUGFREE
   void listFree();                      // list free pages
@@ -58,10 +131,25 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  unsigned pageSize;                  // bytes per page, from the header
+  mutable std::mutex hdrLatch;        // protects hdr and hdrDirty
+  DBPage hdr;                         // header page, read at open and
+                                      // written back at close or sync()
+  bool hdrDirty;                      // hdr differs from page 0 on disk
+
+  std::mutex fsmLatch;                // protects the fields below
+  std::vector<unsigned char> fsm;     // free space categories, 2 per byte
+  std::vector<int> fsmPages;          // map pages, in chain order
+  int fsmLow, fsmHigh;                // pages changed since written, or
+                                      // fsmLow > fsmHigh if none
+  int fsmNext;                        // where the next search starts
+
+  mutable FileStats stats;            // see stats.h
 };
 
 class BufMgr;
 extern BufMgr* bufMgr;
+class LogMgr;
 
 // declarations for hash table of open files
 struct fileHashBucket
@@ -103,23 +191,24 @@ class DB {
   DB();                                 // initialize open file table
   ~DB();                                // clean up any remaining open files
 
-  const Status createFile(const string & fileName) ;  // create a new file
+  const Status createFile(const string & fileName,
+			  const unsigned pageSize = PAGESIZE); // create a new file
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
   const Status openFile(const string & fileName, File* & file);  // open a file
   const Status closeFile(File* file);         // close a file
 
+  // Open the write-ahead log logName, creating it if there is none, and
+  // replay it.  Files are brought up to date on disk, so open the log
+  // before any file whose pages it may hold.  applied tells how many
+  // records were redone.  BufMgr::setLog makes the pool use the log.
+  const Status openLog(const string & logName, LogMgr* & log,
+		       int& applied);
+  const Status closeLog(LogMgr* log);   // flush the log and close it
+
  private:
   OpenFileHashTbl   openFiles;    // list of open files
 };
 
 
-// structure of DB (header) page
-
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
-
 #endif
@@ -17,7 +17,7 @@ enum Status {
 // File and DB errors
 
        BADFILEPTR, BADFILE, FILETABFULL, FILEOPEN, FILENOTOPEN,
-       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS,
+       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS, BADPAGESIZE, BADLOG,
 
 // BufMgr and HashTable errors
 
@@ -67,6 +67,18 @@ class Error {
 };
 
 
+// Stop a test program with a message if the Status of c is not OK, or
+// if condition c does not hold.  CALL needs an Error named error.
+
+#define CALL(c)    { Status s; \
+                     if ((s = c) != OK) { \
+		       cerr << "At line " << __LINE__ << ":" << endl << "  "; \
+                       error.print(s); \
+                       cerr << "TEST DID NOT PASS" <<endl; \
+                       exit(1); \
+                     } \
+                   }
+
 #define ASSERT(c)  { if (!(c)) { \
 		       cerr << "At line " << __LINE__ << ":" << endl << "  "; \
                        cerr << "This condition should hold: " #c << endl; \
@@ -0,0 +1,124 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "db.h"
+#include "stats.h"
+
+// Write-ahead log.  Every change to a page is appended to the log as a
+// redo record holding the changed bytes, and the page is stamped with
+// the record's LSN: the log position just past the record.  A change
+// is durable once the log is on disk up to its LSN, so committing is
+// one sequential log write instead of writing every page it touched.
+// BufMgr writes a page only after the log is on disk up to the page's
+// LSN (write-ahead), and DB::openLog replays the log after a crash.
+//
+// The log file starts with a LogHeader, and the records follow it in
+// LSN order: the record with LSN lsn ends at file offset LOGHDRSIZE +
+// (lsn - startLSN).
+// Page allocation is not logged: a file's header, and with it its
+// free list, is only durable after File::sync.  Instead a page that is
+// allocated or disposed of is stamped with the end of the log, which
+// keeps the records of its earlier use from being replayed over it,
+// and BufMgr::logPage forces a changed header to disk before the first
+// record that follows the change, which keeps a page that recovery
+// brings back from being handed out again.
+
+struct LogHeader
+{
+  unsigned	magic;		// LOGMAGIC
+  unsigned	unused;
+  LSN		startLSN;	// LSN of the first byte after the header
+};
+
+const unsigned LOGMAGIC = 0x4c4f4721;
+const unsigned LOGHDRSIZE = sizeof(LogHeader);
+
+// A redo record.  The file name (nameLen bytes) and the new contents
+// of the changed bytes follow the header.
+struct LogRecord
+{
+  LSN		lsn;		// LSN of this record
+  unsigned	length;		// bytes in the record, header included
+  unsigned	checksum;	// of the record with this field 0
+  int		pageNo;
+  unsigned	offset;		// of the changed bytes within the page
+  unsigned	bytes;		// number of changed bytes
+  unsigned	nameLen;	// length of the file name
+};
+
+struct LogStats
+{
+  Counter records;	// records appended
+  Counter bytes;	// bytes appended
+  Counter commits;	// flush calls that had to wait for the disk
+  Counter syncs;	// fdatasync calls, each commits a group
+  Histogram syncLatency; // ns per write and fdatasync of a group
+
+  void clear()
+    {
+      records.clear(); bytes.clear(); commits.clear(); syncs.clear();
+      syncLatency.clear();
+    }
+};
+
+
+// All public methods may be called concurrently from any threads.
+class LogMgr
+{
+  friend class DB;
+
+public:
+  // Append a redo record: bytes new bytes at offset of page pageNo of
+  // file.  lsn is set to the record's LSN.  The record is only in
+  // memory until a flush covers it.
+  const Status append(const File* file, const int pageNo,
+		      const unsigned offset, const void* data,
+		      const unsigned bytes, LSN& lsn);
+
+  // Make the log durable up to lsn.  Group commit: one thread writes
+  // and syncs everything appended so far while those that come later
+  // wait for it, then the next group goes.  With a group delay the
+  // writing thread first waits that many microseconds for others to
+  // join.  If the write or the sync fails the group stays in memory
+  // and the next flush tries it again.
+  const Status flush(const LSN lsn);
+  void setGroupDelay(const int usecs) { groupDelay = usecs; }
+
+  // Forget all records.  Only valid once every page changed so far has
+  // been written back and synced, e.g. after BufMgr::flushFile(file,
+  // true) of every file, and while no thread appends.
+  const Status truncate();
+
+  LSN getEndLSN();		// LSN of the last record appended
+  LSN getDurableLSN();		// log is on disk up to here
+
+  const LogStats & getStats() const { return stats; }
+  void clearStats() { stats.clear(); }
+
+private:
+  LogMgr();
+  ~LogMgr();
+
+  const Status open(const string & fileName); // open or create
+  const Status recover(DB& db, int& applied); // replay, then truncate
+  const Status writeHeader();
+
+  string	name;
+  int		unixFile;
+  std::mutex	latch;		// protects the fields below
+  std::condition_variable flushed; // a group was written
+  LSN		startLSN;	// of the first record in the file
+  LSN		endLSN;		// past the last record appended
+  LSN		durableLSN;	// on disk up to here
+  std::vector<char> buffer;	// records not yet written
+  LSN		bufferLSN;	// position of buffer[0]
+  bool		flushing;	// a thread is writing a group
+  std::atomic<int> groupDelay;	// microseconds, set without the latch
+  LogStats	stats;
+};
+
+#endif
@@ -23,10 +23,43 @@ struct slot_t {
         short	length;  // equals -1 if slot is not in use
 };
 
+// Page sizes are powers of two from PAGESIZE (the default) to
+// MAXPAGESIZE; offsets within a page must fit in a short.  A file's
+// page size is chosen when it is created.
 const unsigned PAGESIZE = 1024;
-const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
+const unsigned MAXPAGESIZE = 32768;
+const unsigned PAGEALIGN = 512;  // every Page is aligned for O_DIRECT I/O
+
+// log sequence number: the position just past a record in the
+// write-ahead log, see log.h.  0 means never logged.
+typedef unsigned long long LSN;
+
+// Bytes PAGELSNAT to PAGELSNAT + sizeof(LSN) - 1 of every page hold its
+// LSN (Page::lsn).  Once a BufMgr has a log, they belong to the pool
+// on every page it handles, whether init() made it a slotted Page or
+// not: logPage and page writes set them.  Files of raw pages used with
+// a log must leave them alone.
+const unsigned PAGELSNAT = 24;
+
+const unsigned DPFIXED= sizeof(slot_t)+6*sizeof(short)+3*sizeof(int)
+			+sizeof(LSN);
 const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
-// size of the data area of a page
+// size of the data area of a page of PAGESIZE bytes
+
+// true if size can be the page size of a file
+inline bool validPageSize(const unsigned size)
+{
+  return size >= PAGESIZE && size <= MAXPAGESIZE && (size & (size - 1)) == 0;
+}
+
+// How a page handles deletions, chosen when it is initialized
+enum PageMode {
+  PAGE_COMPACT = 0,	// records are moved together on every delete and
+			// insert looks for a free slot linearly
+  PAGE_LAZY = 1		// deletes leave holes that are squeezed out only
+			// when an insert needs the room, and free slots
+			// are kept on a chain
+};
 
 // Class definition for a minirel data page.   
 // The design assumes that records are kept compacted when
@@ -34,25 +67,58 @@ const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
 // array cannot be compacted.  Notice, this class does not keep
 // the records align, relying instead on upper levels to take
 // care of non-aligned attributes
-
-class Page {
+//
+// The class describes the first PAGESIZE bytes of a page; a bigger
+// page is viewed through a Page* to the start of its frame.  The fixed
+// fields come first, data[] runs on past the end of the class, and the
+// slot array grows backwards from the last byte of the page.
+//
+// In PAGE_LAZY mode a free slot has length -2 - n, where n is the
+// number of the next free slot (-1 at the end of the chain), and its
+// offset is that of the hole its record left, or -1 if there is none.
+
+class alignas(PAGEALIGN) Page {
 private:
-    char 	data[PAGESIZE - DPFIXED]; 
-    slot_t 	slot[1]; // first element of slot array - grows backwards!
     short	slotCnt; // number of slots in use;
     short	freePtr; // offset of first free byte in data[]
     short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
+    short	sizeShift; // log2 of the page size, 0 until init()
+    short	mode;	  // a PageMode
+    short	freeSlot; // first free slot (PAGE_LAZY), -1 if none
     int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
+    int		spare;	  // keeps lsn aligned
+    LSN		lsn;	  // last logged change, see BufMgr::logPage
+    char 	data[PAGESIZE - DPFIXED + sizeof(slot_t)]; 
+
+    // first element of slot array - grows backwards!
+    slot_t* slotArray() const
+    {
+	return (slot_t*)((char*)this + size()) - 1;
+    }
+
+    // bytes between the last record and the slot array
+    int gap() const
+    {
+	return (char*)&slotArray()[slotCnt + 1] - &data[freePtr];
+    }
+    void compact();		  // move the records together
+    const Status punchHole(const RID& rid); // free rid's slot, leave a hole
 
 public:
-    void init(const int pageNo); // initialize a new page
+    void init(const int pageNo, const unsigned pageSize = PAGESIZE,
+	      const PageMode mode = PAGE_COMPACT); // initialize a new page
+    unsigned size() const { return sizeShift ? 1u << sizeShift : PAGESIZE; }
     void dumpPage() const;       // dump contents of a page
 
     const Status getNextPage(int& pageNo) const; // returns value of nextPage
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
     const short getFreeSpace() const; // returns amount of free space
+    // true if init() made this page number pageNo of a file with pages
+    // of pageSize bytes, as far as the fixed fields tell
+    bool isSlotted(const int pageNo, const unsigned pageSize) const;
+    LSN getLSN() const { return lsn; }
+    void setLSN(const LSN l) { lsn = l; }
 
     // inserts a new record (rec) into the page, returns RID of record 
     const Status insertRecord(const Record & rec, RID& rid);
@@ -60,6 +126,17 @@ public:
     // delete the record with the specified rid
     const Status deleteRecord(const RID & rid);
 
+    // insert recs[0..n-1] in order until one does not fit; the RIDs go
+    // to rids and inserted tells how many made it.  Returns NOSPACE if
+    // not all of them did.  Compacts the page at most once.
+    const Status insertRecords(const Record* recs, const int n, RID* rids,
+			       int& inserted);
+
+    // delete the records with rids[0..n-1], stopping at the first that
+    // is not on the page (INVALIDSLOTNO).  Compacts the page at most
+    // once, and in PAGE_LAZY mode not at all.
+    const Status deleteRecords(const RID* rids, const int n);
+
     // returns RID of first record on page
     // returns  NORECORDS if page contains no records.  Otherwise, returns OK
     const Status firstRecord(RID& firstRid) const;
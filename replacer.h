@@ -0,0 +1,226 @@
+#ifndef REPLACER_H
+#define REPLACER_H
+
+#include <atomic>
+#include <mutex>
+#include "db.h"
+
+class BufHashTbl;
+
+// buffer replacement policies a BufMgr can be constructed with
+enum ReplPolicy {
+  CLOCK,	// single reference bit clock (the default)
+  TWOQ,		// 2Q: probationary FIFO, ghost FIFO and a protected LRU
+  ARC		// adaptive replacement cache
+};
+
+
+// Replacement policy of a BufMgr.  A policy keeps whatever per-frame
+// state it needs in its own arrays, so BufDesc only carries what every
+// access needs.  BufMgr calls
+//   touch()   when readPage finds a page in the pool,
+//   insert()  once a page has been placed in a frame; cold is set for
+//             pages read ahead that nobody has asked for yet, which
+//             go where they will be evicted first,
+//   erase()   when a frame is emptied, either because allocBuf evicted
+//             its page (evicted is true) or because the page was
+//             disposed of or flushed out,
+//   victim()  from allocBuf to get the frames to try in eviction order.
+// All methods may be called concurrently.
+class Replacer
+{
+public:
+  virtual ~Replacer() {}
+
+  virtual void touch(const int frame) = 0;
+  virtual void insert(const int frame, const File* file, const int pageNo,
+                      const bool cold) = 0;
+  virtual void erase(const int frame, const bool evicted) = 0;
+
+  // attempt-th frame allocBuf should try during one allocation, or -1
+  // when there are no more candidates.  Empty frames come first.
+  virtual int victim(const int attempt) = 0;
+
+  // fill frames with the next n frames victim() would offer, without
+  // moving the clock hand or anything else; returns how many it found.
+  // Used by the background writer to look ahead.
+  virtual int upcoming(int* frames, const int n) = 0;
+
+  // number of candidates allocBuf should try before giving up
+  virtual int maxAttempts() const = 0;
+
+  static Replacer* create(const ReplPolicy policy, const int numBufs);
+};
+
+
+// The classic clock: a frame gets a second chance if it was referenced
+// since the hand last passed it.  Lock free.
+class ClockReplacer : public Replacer
+{
+private:
+  int numBufs;
+  std::atomic<unsigned int> clockHand;
+  std::atomic<bool>* refbit;	// has this buffer frame been reference recently
+
+  unsigned int advanceClock()	// returns the frame under the new hand position
+  {
+	return (clockHand.fetch_add(1) + 1) % numBufs;
+  }
+
+public:
+  ClockReplacer(const int bufs);
+  ~ClockReplacer();
+
+  void touch(const int frame) { refbit[frame] = true; }
+  void insert(const int frame, const File* file, const int pageNo,
+              const bool cold) { refbit[frame] = !cold; }
+  void erase(const int frame, const bool evicted) { refbit[frame] = false; }
+  int victim(const int attempt);
+  int upcoming(int* frames, const int n);
+  int maxAttempts() const { return numBufs * 2; }
+};
+
+
+// Doubly linked list of frame (or ghost entry) numbers.  The links live
+// in arrays shared by all lists of one policy, since an entry is on at
+// most one list at a time.
+class FrameList
+{
+private:
+  int*	prev;
+  int*	next;
+
+public:
+  int	head;	// least recently added, -1 if empty
+  int	tail;	// most recently added, -1 if empty
+  int	size;
+
+  FrameList() : prev(NULL), next(NULL), head(-1), tail(-1), size(0) {}
+  void attach(int* prevLinks, int* nextLinks) { prev = prevLinks; next = nextLinks; }
+
+  void pushBack(const int n);
+  void pushFront(const int n);
+  void remove(const int n);
+  int after(const int n) const { return next[n]; }
+};
+
+
+// Pages recently evicted, remembered by (File, pageNo) only.  Used by
+// 2Q and ARC to recognize a page that comes back soon after eviction.
+class GhostList
+{
+private:
+  int		capacity;
+  const File**	file;
+  int*		pageNo;
+  int*		prev;
+  int*		next;
+  FrameList	unused;		// free entries
+  BufHashTbl*	index;		// (file, pageNo) -> entry
+
+public:
+  FrameList	list[2];	// ARC uses two ghost lists, 2Q one
+
+  GhostList(const int entries);
+  ~GhostList();
+
+  // remember (file, pageNo) at the end of list[which]
+  void add(const int which, const File* f, const int p);
+  // forget the oldest entry of list[which]
+  void drop(const int which);
+  // forget (file, pageNo); returns the list it was on or -1
+  int remove(const File* f, const int p);
+};
+
+
+// number of hits a thread collects before it applies them to a list
+// based policy, see ListReplacer::touch()
+const int TOUCHBATCH = 32;
+
+// Base of the policies that keep frames on ordered lists.  Frames that
+// hold no page are kept on the free list and offered first.
+//
+// Hits do not take the latch one by one: each thread queues the frames
+// it touched and applies them in one go once it has TOUCHBATCH / 2 of
+// them and the latch is free, or TOUCHBATCH of them in any case.  A
+// hit thus reaches the lists a little late, which only makes the order
+// slightly less exact.  A queued hit carries the generation of its
+// frame, which every insert() bumps, so a hit on a page that has left
+// the frame meanwhile is dropped rather than promoting the new page.
+// victim() remembers, per thread, where the last
+// attempt stopped, so one allocation walks the lists once.
+class ListReplacer : public Replacer
+{
+protected:
+  int		numBufs;
+  int		id;		// tells the queues of threads apart
+  std::mutex	latch;		// protects everything below
+  int*		prev;
+  int*		next;
+  int*		where;		// list a frame is on, index into lists[]
+  const File**	file;		// page each frame holds
+  int*		pageNo;
+  std::atomic<unsigned>* gen;	// inserts into each frame, read by touch()
+  FrameList	lists[3];	// lists[0] is the free list
+
+  void move(const int frame, const int to, const bool front = false);
+  // the three lists in the order victims are taken from them
+  virtual const int* order() const = 0;
+  // apply a hit on frame; the latch is held
+  virtual void promote(const int frame) = 0;
+
+public:
+  ListReplacer(const int bufs);
+  ~ListReplacer();
+
+  void touch(const int frame);
+  int victim(const int attempt);
+  int upcoming(int* frames, const int n);
+  int maxAttempts() const { return numBufs; }
+};
+
+
+// 2Q (Johnson and Shasha).  A page seen once stays on the A1in FIFO;
+// only a page that comes back after falling off A1in (found on the
+// A1out ghost list) is promoted to the Am LRU, so a scan cannot flush
+// pages that are used repeatedly.
+class TwoQReplacer : public ListReplacer
+{
+private:
+  int		kin;		// target size of A1in
+  GhostList	a1out;
+
+  const int* order() const;
+  void promote(const int frame);
+
+public:
+  TwoQReplacer(const int bufs);
+
+  void insert(const int frame, const File* file, const int pageNo,
+              const bool cold);
+  void erase(const int frame, const bool evicted);
+};
+
+
+// ARC (Megiddo and Modha).  T1 holds pages seen once, T2 pages seen at
+// least twice, and the ghost lists B1 and B2 remember what was evicted
+// from each.  A hit on a ghost moves the target size p of T1 towards
+// the list that would have kept the page.
+class ARCReplacer : public ListReplacer
+{
+private:
+  int		p;		// target size of T1
+  GhostList	ghosts;
+
+  const int* order() const;
+  void promote(const int frame);
+
+public:
+  ARCReplacer(const int bufs);
+
+  void insert(const int frame, const File* file, const int pageNo,
+              const bool cold);
+  void erase(const int frame, const bool evicted);
+};
+
+#endif
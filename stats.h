@@ -0,0 +1,151 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+// define to compile out the per-file counters, the latency and sweep
+// histograms and the clock reads they take; the BufStats counters of
+// the pool stay
+//#define NOSTATS
+
+#ifdef NOSTATS
+#define STAT(x)
+#else
+#define STAT(x)	x
+#endif
+
+
+// number of cells a Counter is spread over
+const int STATCELLS = 8;
+
+// 64-bit event counter that many threads can bump at once.  Each thread
+// adds to one of STATCELLS cells, each on its own cache line, so the
+// counter does not bounce between processors; reading it sums the
+// cells and may miss additions made meanwhile.
+class Counter
+{
+public:
+  Counter() { clear(); }
+  Counter(const Counter&) = delete;
+
+  void add(const unsigned long long n)
+  {
+	cells[cell()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  Counter& operator++() { add(1); return *this; }
+  void operator++(int) { add(1); }
+  Counter& operator+=(const unsigned long long n) { add(n); return *this; }
+
+  unsigned long long get() const
+  {
+	unsigned long long sum = 0;
+	for (int i = 0; i < STATCELLS; i++)
+	  sum += cells[i].value.load(std::memory_order_relaxed);
+	return sum;
+  }
+  operator unsigned long long() const { return get(); }
+
+  void clear()
+  {
+	for (int i = 0; i < STATCELLS; i++)
+	  cells[i].value.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  struct alignas(64) Cell
+  {
+    std::atomic<unsigned long long> value;
+  };
+  Cell cells[STATCELLS];
+
+  // the cell of the calling thread; threads take cells round robin
+  static int cell()
+  {
+	static std::atomic<int> next(0);
+	static thread_local int mine = next++ % STATCELLS;
+	return mine;
+  }
+};
+
+
+// Values of a Histogram at one point in time.
+const int HISTBUCKETS = 48;
+
+struct HistSnapshot
+{
+  unsigned long long count;	// values recorded
+  unsigned long long sum;	// their total
+  unsigned long long buckets[HISTBUCKETS];
+
+  // mean, and an upper bound on the pct percentile (0 to 100): the
+  // top of the bucket it falls in
+  double mean() const { return count ? (double)sum / count : 0; }
+  unsigned long long percentile(const double pct) const;
+
+  void printText(std::ostream& os, const char* unit) const;
+  void printJSON(std::ostream& os) const;
+};
+
+// Histogram of non-negative values in power of two buckets: bucket 0
+// counts zeros, bucket b > 0 values from 2^(b-1) up to 2^b - 1.
+class Histogram
+{
+public:
+  Histogram() { clear(); }
+  Histogram(const Histogram&) = delete;
+
+  void record(const unsigned long long value)
+  {
+	int b = value == 0 ? 0 : 64 - __builtin_clzll(value);
+	if (b >= HISTBUCKETS)
+	  b = HISTBUCKETS - 1;
+	buckets[b].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void snapshot(HistSnapshot& snap) const;
+  void clear();
+
+private:
+  std::atomic<unsigned long long> buckets[HISTBUCKETS];
+  std::atomic<unsigned long long> sum;
+};
+
+
+// nanoseconds on a monotonic clock, for timing with histograms
+unsigned long long statClock();
+
+
+// What the buffer manager and the I/O layer did for one file.  The
+// File keeps these; BufMgr counts the pool events of its pages.
+struct FileStats
+{
+  Counter hits;			// readPage found the page in the pool
+  Counter misses;		// readPage had to read it
+  Counter evictions;		// pages of the file evicted
+  Counter dirtyEvictions;	// of which had to be written first
+  Counter flushes;		// flushFile calls
+  Counter allocs;		// pages allocated
+  Counter reads;		// intread calls
+  Counter writes;		// pages written, one pwritev may write many
+  Histogram readLatency;	// ns per intread
+  Histogram writeLatency;	// ns per intwrite or intwritev
+
+  void clear();
+};
+
+// The values of a FileStats at one point in time.
+struct FileSnapshot
+{
+  std::string name;
+  unsigned long long hits, misses, evictions, dirtyEvictions;
+  unsigned long long flushes, allocs, reads, writes;
+  HistSnapshot readLatency, writeLatency;
+
+  void printText(std::ostream& os) const;
+  void printJSON(std::ostream& os) const;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include "db.h"
+#include "buf.h"
+
+// Setup and teardown shared by stressbuf and the benchmarks.  They
+// work through the program's global bufMgr and stop the program on any
+// error, as CALL does.
+
+extern BufMgr* bufMgr;
+
+// destroy name if an earlier run left it behind
+void removeFile(DB& db, const char* name);
+
+// remove name, then create it with pages of pageSize bytes and open it
+void createFresh(DB& db, const char* name, File*& file,
+                 const unsigned pageSize = PAGESIZE);
+
+// close file and destroy it; its pages leave the pool on the way
+void dropFile(DB& db, File* file, const char* name);
+
+// allocate count pages of file, start each with "<tag> Page <pageNo>"
+// and unpin it dirty.  The page numbers go to pageNos unless it is NULL.
+void fillPages(File* file, const char* tag, const int count,
+               int* pageNos = NULL);
+
+// true if page starts as fillPages left page pageNo
+bool hasTag(const Page* page, const char* tag, const int pageNo);
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef ZCACHE_H
+#define ZCACHE_H
+
+#include <ostream>
+#include "db.h"
+#include "stats.h"
+
+// Compressed second tier of the buffer pool.  Pages that BufMgr evicts
+// clean (or writes and then evicts) are kept here compressed, within a
+// fixed memory budget, and a miss in the pool takes the page back from
+// here before it goes to disk.  A page lives either in the pool or in
+// the tier, never in both: get() removes what it finds.  Entries always
+// hold what is on disk, so dropping one is never wrong; the least
+// recently stored ones go when the budget is full.
+//
+// The budget covers the compressed bytes plus ZENTRYOVERHEAD per page
+// for the bookkeeping.  Pages that do not compress to at most
+// ZMAXFRACTION of their size are not kept, as a frame would hold them
+// about as well.
+
+// built-in compressor: LZ77 in the style of LZ4, byte aligned, with
+// matches of at least ZMINMATCH bytes found through a hash table of
+// 2^ZHASHBITS positions.  zcompress returns the compressed length, or 0
+// if the result does not fit in outMax bytes.  zdecompress returns
+// false unless in decodes to exactly outLen bytes.
+const int ZMINMATCH = 4;
+const int ZHASHBITS = 12;
+
+unsigned zcompress(const char* in, const unsigned n, char* out,
+                   const unsigned outMax);
+bool zdecompress(const char* in, const unsigned n, char* out,
+                 const unsigned outLen);
+
+const unsigned ZENTRYOVERHEAD = 96;
+const double   ZMAXFRACTION = 0.75;
+
+// number of independently latched parts, each with its share of the
+// budget
+const int ZPARTS = 16;
+
+struct ZStats
+{
+  Counter hits;		// get() found the page
+  Counter misses;	// get() did not
+  Counter puts;		// pages stored
+  Counter rejects;	// pages that did not compress well enough
+  Counter evictions;	// pages dropped to stay within the budget
+  Counter bytesIn;	// bytes of the pages compressed well enough
+  Counter bytesOut;	// bytes they compressed to
+
+  void clear()
+    {
+      hits.clear(); misses.clear(); puts.clear(); rejects.clear();
+      evictions.clear(); bytesIn.clear(); bytesOut.clear();
+    }
+};
+
+// The counters of a ZCache at one point in time, with its fill.
+struct ZSnapshot
+{
+  unsigned long long budget;	// bytes, 0 if there is no tier
+  unsigned long long pages;	// pages held
+  unsigned long long bytes;	// bytes used of the budget
+  unsigned long long hits, misses, puts, rejects, evictions;
+  unsigned long long bytesIn, bytesOut;
+
+  double hitRatio() const
+    { return hits + misses ? (double)hits / (hits + misses) : 0; }
+  // uncompressed to compressed size of the pages stored
+  double compressionRatio() const
+    { return bytesOut ? (double)bytesIn / bytesOut : 0; }
+
+  void printText(std::ostream& os) const;
+  void printJSON(std::ostream& os) const;
+};
+
+
+// All methods may be called concurrently from any threads.
+class ZCache
+{
+public:
+  ZCache(const unsigned long long budget);	// in bytes
+  ~ZCache();
+
+  // Compress size bytes of page into out, which has room for size
+  // bytes.  Returns the compressed length, 0 if the page does not
+  // compress well enough to keep.  Done apart from put() so that a
+  // caller can compress before it takes its own latches.
+  unsigned compress(const Page* page, const unsigned size, char* out);
+
+  // Store the n bytes compress() made of page pageNo of file, replacing
+  // any older copy; with n 0 just drop any older copy.
+  void put(const File* file, const int pageNo, const char* data,
+           const unsigned n);
+
+  // If page pageNo of file is held, decompress its size bytes into page,
+  // drop it from the tier and return true.
+  bool get(const File* file, const int pageNo, Page* page,
+           const unsigned size);
+
+  void erase(const File* file, const int pageNo);
+  void eraseFile(const File* file);	// all pages of file
+
+  unsigned long long getBudget() const { return budget; }
+  const ZStats & getStats() const { return stats; }
+  void clearStats() { stats.clear(); }
+  void snapshot(ZSnapshot& snap) const;
+
+private:
+  struct Part;			// see zcache.C
+  Part*		parts;
+  unsigned long long budget;
+  ZStats	stats;
+
+  Part& part(const File* file, const int pageNo) const;
+};
+
+#endif